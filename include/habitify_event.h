@@ -19,11 +19,23 @@
 #ifndef HABITIFY_EVENT_BUS_SRC_HABITIFY_EVENT_H_
 #define HABITIFY_EVENT_BUS_SRC_HABITIFY_EVENT_H_
 
+#include <chrono>
+#include <cstdint>
+
 namespace habitify {
 
-enum EventType { TEST, TEST2 };
+enum EventType { TEST, TEST2, REQUEST, REPLY, SNAPSHOT };
+
+/// Events of higher priority are served first by dispatchers such as the
+/// Service behind EventBus::Serve.
+enum EventPriority { LOW, NORMAL, HIGH };
+
+using DeadlineType = std::chrono::steady_clock::time_point;
 
 using ChannelIdType = int;
+/// Identifies a request and its reply. 0 is used for events that are not part
+/// of a request.
+using CorrelationIdType = uint64_t;
 
 namespace internal {
 class EventBase {
@@ -35,9 +47,29 @@ class EventBase {
 
   inline const EventType &get_event_type() const { return event_type_; }
   inline const ChannelIdType &get_channel_id() const { return channel_id_; }
+  inline const CorrelationIdType &get_correlation_id() const {
+    return correlation_id_;
+  }
+  inline const EventPriority &get_priority() const { return priority_; }
+  inline const DeadlineType &get_deadline() const { return deadline_; }
+  /// Returns true if the deadline of the event has passed. Expired events are
+  /// not delivered.
+  inline bool IsExpired() const {
+    return deadline_ != DeadlineType::max() &&
+           std::chrono::steady_clock::now() > deadline_;
+  }
 
   inline void set_event_type(const EventType &etype) { event_type_ = etype; }
   inline void set_channel_id(const ChannelIdType &id) { channel_id_ = id; }
+  inline void set_correlation_id(const CorrelationIdType &id) {
+    correlation_id_ = id;
+  }
+  inline void set_priority(const EventPriority &priority) {
+    priority_ = priority;
+  }
+  inline void set_deadline(const DeadlineType &deadline) {
+    deadline_ = deadline;
+  }
 
   // TODO: Add assert to check for missmatch of type. Do this after fixing the
   // error in PublisherTest
@@ -60,6 +92,10 @@ class EventBase {
   // TODO: remove channel ID since this is handled by the Publisher and Listener
   // anyways.
   ChannelIdType channel_id_ = 0;
+  CorrelationIdType correlation_id_ = 0;
+  EventPriority priority_ = EventPriority::NORMAL;
+  // DeadlineType::max() means that the event never expires.
+  DeadlineType deadline_ = DeadlineType::max();
 };
 }  // namespace internal
 
@@ -27,8 +27,16 @@
 ///       Listener objects.
 ///       - Publisher<EvType> interface to store and publish data
 ///       asynchronously.
+///       - BatchPublisher<T> stores trivially copyable payloads contiguously
+///       without wrapping them into Event<T> objects. Listeners read them via
+///       Listener::ReadBatch<T>().
+///       - DeltaPublisher<T> publishes patches against a versioned snapshot of
+///       a large state object. Listeners catch up via Listener::CatchUp<T>().
 ///       - Listener serves as interface to the Publisher and exposes reading
 ///       functionality.
+///       - EventBus::Serve<Req, Resp> and EventBus::Request<Req, Resp>
+///       implement a request/reply pattern. Replies are matched to requests via
+///       the correlation ID of the event and routed directly to the caller.
 ///           NOTE: EvType is the type which is used to instatiate the Event<T>
 ///           object e.g. Event<int>
 ///           NOTE: Listener and Publisher need to be created as shared_ptr to
@@ -38,15 +46,25 @@
 #ifndef HABITIFY_EVENT_BUS_SRC_HABITIFY_EVENT_BUS_H_
 #define HABITIFY_EVENT_BUS_SRC_HABITIFY_EVENT_BUS_H_
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <deque>
 #include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <shared_mutex>
+#include <span>
+#include <thread>
 #include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "include/habitify_event.h"
@@ -84,6 +102,13 @@ class PublisherBase : public std::enable_shared_from_this<PublisherBase> {
   // Getters and Setters:
   inline const ChannelIdType& get_channel_id() { return channel_id_; }
   inline const bool get_is_registered() { return is_registered_; }
+  /// Returns the priority of the channel. This is advisory metadata: it is not
+  /// applied to the published events. Consumers reading from multiple channels
+  /// can use it to decide which channel to serve first.
+  inline const EventPriority get_priority() {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+    return priority_;
+  }
   /// Returns a conditonal_variable_any that is notified by Publish().
   inline std::shared_ptr<std::condition_variable_any> get_cv() { return cv_; }
   /// Returns the latest Event as it's base class. This is mostly used for
@@ -101,23 +126,61 @@ class PublisherBase : public std::enable_shared_from_this<PublisherBase> {
   }
 
  protected:
-  /// This function is called by Listener::ReadLatest and is implemented by
-  /// the derived class.
+  /// This function is called by ReadNextLatestImpl and GetLatestEvent and is
+  /// implemented by the derived class.
   virtual const std::shared_ptr<const internal::EventBase> ReadLatestImpl() {
     return nullptr;
   }
 
+  /// This function is called by Listener::ReadLatest. It returns the latest
+  /// event and advances read_index past it. Publishers that count reads
+  /// differently, such as DeltaPublisher, override it.
+  virtual const std::shared_ptr<const internal::EventBase> ReadNextLatestImpl(
+      size_t& read_index) {
+    auto event = ReadLatestImpl();
+    if (event != nullptr) ++read_index;
+    return event;
+  }
+
+  /// This function is called by Listener::CatchUp and is implemented by
+  /// DeltaPublisher. state points to an object of type type. Returns false if
+  /// type does not match or there is nothing new.
+  virtual bool CatchUpImpl(void* state, size_t& version,
+                           const std::type_info& type) {
+    return false;
+  }
+
+  /// This function is called by Listener::ReadBatch and is implemented by
+  /// BatchPublisher. It returns a pointer to the contiguous events starting at
+  /// index together with the amount of events that can be read from there.
+  /// If type does not match the type of the stored events nothing is returned.
+  virtual std::pair<const void*, size_t> ReadBatchImpl(
+      size_t index, size_t max_count, const std::type_info& type) {
+    return {nullptr, 0};
+  }
+
   /// CreatePublisher(const ChannelIdType& channel) is called by EventBus and
   /// sets all the necessary members.
-  bool PublisherBase::CreatePublisher(const std::shared_ptr<Channel> channel) {
+  bool PublisherBase::CreatePublisher(
+      const std::shared_ptr<Channel> channel,
+      EventPriority priority = EventPriority::NORMAL) {
     std::unique_lock<std::shared_mutex> lock(mux_);
 
     channel_ = channel;
     channel_id_ = channel->get_channel_id();
+    priority_ = priority;
 
     return is_registered_ = true;
   }
 
+  /// Raises the priority of the channel if priority is higher. This is called
+  /// by EventBus when an existing Publisher is shared so that a requested
+  /// priority is merged instead of being discarded.
+  void RaisePriority(EventPriority priority) {
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    priority_ = std::max(priority_, priority);
+  }
+
  protected:
   mutable std::shared_mutex mux_;
   std::shared_ptr<std::condition_variable_any> cv_;
@@ -128,6 +191,184 @@ class PublisherBase : public std::enable_shared_from_this<PublisherBase> {
   /// channel_id_ refers to a predefined ChannelId and is used for
   /// identification by the Listener.
   ChannelIdType channel_id_ = 0;
+  EventPriority priority_ = EventPriority::NORMAL;
+};
+
+/// OwningEvent stores the data of the Event itself instead of pointing to data
+/// owned by the caller. It is used for events created by the EventBus such as
+/// requests and replies.
+template <typename T>
+class OwningEvent : public Event<T> {
+ public:
+  OwningEvent(EventType etype, ChannelIdType channel_id, T data)
+      : Event<T>(etype, channel_id, &data_), data_(std::move(data)) {}
+  ~OwningEvent() = default;
+
+  // OwningEvent is not copyable since Event<T> points to data_
+  OwningEvent(const OwningEvent&) = delete;
+  const OwningEvent& operator=(const OwningEvent&) = delete;
+
+ private:
+  T data_;
+};
+
+/// ServiceBase is used as a way of storing Service in the Channel. Use
+/// EventBus::Serve and EventBus::Request as the interface!
+class ServiceBase {
+ public:
+  ServiceBase() = default;
+  virtual ~ServiceBase() = default;
+
+  // ServiceBase is not copyable since it owns a worker thread
+  ServiceBase(const ServiceBase&) = delete;
+  const ServiceBase& operator=(const ServiceBase&) = delete;
+};
+
+/// Service answers requests of type Req with replies of type Resp. Requests
+/// are queued and handled by a worker thread owned by the Service. Each
+/// request carries its own promise so the reply is handed directly to the
+/// waiting caller instead of being broadcast to all Listeners of a channel.
+/// Requests of higher priority are handled first and requests with the same
+/// priority are handled by earliest deadline. Expired requests are dropped
+/// before they reach the handler.
+template <typename Req, typename Resp>
+class Service : public ServiceBase {
+ public:
+  using Handler = std::function<Resp(const Event<Req>&)>;
+  using Reply = std::shared_ptr<const Event<Resp>>;
+
+  /// A queued request gains one priority level for every kAgingInterval it
+  /// waits. This keeps a flood of high priority requests from starving the
+  /// others.
+  static constexpr std::chrono::milliseconds kAgingInterval{100};
+
+  Service(const ChannelIdType& channel_id, Handler handler)
+      : channel_id_(channel_id),
+        handler_(std::move(handler)),
+        worker_([this]() { Run(); }) {}
+
+  /// Stops the worker thread. Requests that were not handled yet resolve to
+  /// nullptr.
+  ~Service() {
+    {
+      std::unique_lock<std::mutex> lock(mux_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+  }
+
+  /// Queues the request and returns a future to the reply. The future resolves
+  /// to nullptr if the request is still queued when its deadline passes. A
+  /// request that is already being handled is not interrupted.
+  std::future<Reply> Submit(const CorrelationIdType& correlation_id,
+                            Req request, const DeadlineType& deadline,
+                            EventPriority priority) {
+    PendingRequest pending;
+    pending.event = std::make_unique<OwningEvent<Req>>(
+        EventType::REQUEST, channel_id_, std::move(request));
+    pending.enqueued = std::chrono::steady_clock::now();
+    pending.event->set_correlation_id(correlation_id);
+    pending.event->set_deadline(deadline);
+    pending.event->set_priority(priority);
+    auto reply = pending.promise.get_future();
+
+    {
+      std::unique_lock<std::mutex> lock(mux_);
+      queue_.push_back(std::move(pending));
+    }
+    cv_.notify_one();
+
+    return reply;
+  }
+
+ private:
+  struct PendingRequest {
+    std::unique_ptr<OwningEvent<Req>> event;
+    std::chrono::steady_clock::time_point enqueued;
+    std::promise<Reply> promise;
+  };
+
+  /// Returns the priority of the request including the levels it gained while
+  /// waiting in the queue.
+  static long long EffectivePriority(
+      const PendingRequest& pending,
+      const std::chrono::steady_clock::time_point& now) {
+    return pending.event->get_priority() +
+           (now - pending.enqueued) / kAgingInterval;
+  }
+
+  /// Drops all expired requests and removes the next request to handle from
+  /// queue_. queue_ is in submission order so ties are resolved first come
+  /// first serve. Requires mux_ to be locked and at least one request queued.
+  bool PopNext(PendingRequest& next) {
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto it = queue_.begin(); it != queue_.end();) {
+      if (it->event->IsExpired()) {
+        // Requests whose caller already gave up are dropped unhandled.
+        it->promise.set_value(nullptr);
+        it = queue_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    if (queue_.empty()) return false;
+
+    auto best = queue_.begin();
+    auto best_priority = EffectivePriority(*best, now);
+    for (auto it = std::next(best); it != queue_.end(); ++it) {
+      auto priority = EffectivePriority(*it, now);
+      if (priority > best_priority ||
+          (priority == best_priority &&
+           it->event->get_deadline() < best->event->get_deadline())) {
+        best = it;
+        best_priority = priority;
+      }
+    }
+
+    next = std::move(*best);
+    queue_.erase(best);
+    return true;
+  }
+
+  /// Run() is executed by worker_ and handles the queued requests.
+  void Run() {
+    while (true) {
+      PendingRequest pending;
+      {
+        std::unique_lock<std::mutex> lock(mux_);
+        cv_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+        if (stop_) break;
+
+        if (!PopNext(pending)) continue;
+      }
+
+      try {
+        auto reply = std::make_shared<OwningEvent<Resp>>(
+            EventType::REPLY, channel_id_, handler_(*pending.event));
+        reply->set_correlation_id(pending.event->get_correlation_id());
+        pending.promise.set_value(std::move(reply));
+      } catch (...) {
+        pending.promise.set_exception(std::current_exception());
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(mux_);
+    for (auto& pending : queue_) pending.promise.set_value(nullptr);
+    queue_.clear();
+  }
+
+ private:
+  std::mutex mux_;
+  std::condition_variable cv_;
+  bool stop_ = false;
+  std::deque<PendingRequest> queue_;
+
+  ChannelIdType channel_id_;
+  Handler handler_;
+  // worker_ is declared last so that it starts after all members are set.
+  std::thread worker_;
 };
 
 /// Channel is used to store the Publisher and Listener objects together.
@@ -152,6 +393,10 @@ class Channel {
   inline const std::vector<std::shared_ptr<Listener>> get_listeners() {
     return listeners_;
   }
+  inline const std::shared_ptr<ServiceBase> get_service() {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+    return service_;
+  }
   /// Adds a new Listener to the Channel.
   void Channel::RegisterListener(std::shared_ptr<Listener> listener) {
     std::unique_lock<std::shared_mutex> lock(mux_);
@@ -184,11 +429,22 @@ class Channel {
     return publisher_;
   }
 
+  /// Registers the Service that answers requests sent to this Channel. Returns
+  /// false if the Channel is already served.
+  bool Channel::CreateService(std::shared_ptr<ServiceBase> service) {
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    if (service_) return false;
+
+    service_ = service;
+    return true;
+  }
+
  private:
   std::shared_mutex mux_;
 
   ChannelIdType channel_id_;
   std::shared_ptr<PublisherBase> publisher_;
+  std::shared_ptr<ServiceBase> service_;
   std::vector<std::shared_ptr<Listener>> listeners_;
 };
 }  // namespace internal
@@ -214,10 +470,11 @@ class Publisher : public internal::PublisherBase {
   const Publisher& operator=(const Publisher&) = delete;
 
   /// Publisher::HasReceivedEvent(size_t index) checks if there are unread
-  /// events for the Listener
+  /// events for the Listener. Expired events do not count as unread.
   virtual bool HasReceivedEvent(size_t index) override {
     std::shared_lock<std::shared_mutex> lock(mux_);
-    return index < writer_index_;
+    size_t newest = NewestLiveIndex();
+    return newest != writer_index_ && newest >= index;
   }
 
   /// Publisher<EvTyp>::Publish(std::unique_ptr< const internal::EventBase>)
@@ -232,6 +489,16 @@ class Publisher : public internal::PublisherBase {
         std::shared_ptr<const internal::EventBase>(std::move(event));
     event_storage_.emplace(writer_index_, shared_event);
 
+    // Events that expire no later than the new one can never become the
+    // newest event that has not expired again.
+    auto deadline = shared_event->get_deadline();
+    auto now = std::chrono::steady_clock::now();
+    while (!live_events_.empty() && (live_events_.back().second <= deadline ||
+                                     live_events_.back().second < now))
+      live_events_.pop_back();
+    if (!shared_event->IsExpired())
+      live_events_.emplace_back(writer_index_, deadline);
+
     cv_->notify_all();
     ++writer_index_;
     return true;
@@ -240,14 +507,14 @@ class Publisher : public internal::PublisherBase {
   inline const size_t get_writer_index() { return writer_index_; }
 
  protected:
-  /// See PublisherBase::ReadLatestImpl()
+  /// See PublisherBase::ReadLatestImpl(). Expired events are dropped instead
+  /// of being delivered, so this returns the newest event that has not
+  /// expired.
   virtual const std::shared_ptr<const internal::EventBase> ReadLatestImpl()
       override {
     std::shared_lock<std::shared_mutex> lock(mux_);
 
-    if (event_storage_.empty()) return nullptr;
-
-    auto event = event_storage_.find(writer_index_ - 1);
+    auto event = event_storage_.find(NewestLiveIndex());
     if (event == event_storage_.end()) return nullptr;
 
     return event->second;
@@ -262,10 +529,301 @@ class Publisher : public internal::PublisherBase {
     return std::shared_ptr<Publisher<EvTyp>>(new Publisher<EvTyp>());
   }
 
+  /// Returns the index of the newest event that has not expired or
+  /// writer_index_ if there is none. Only the expired events at the back of
+  /// live_events_ are checked. Requires mux_ to be locked.
+  size_t NewestLiveIndex() {
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = live_events_.rbegin(); it != live_events_.rend(); ++it) {
+      if (it->second >= now) return it->first;
+    }
+    return writer_index_;
+  }
+
  private:
   std::unordered_map<int, std::shared_ptr<const internal::EventBase>>
       event_storage_;
   size_t writer_index_ = 0;
+
+  /// Index and deadline of every event that may still become the newest event
+  /// that has not expired, oldest first. Publish() drops events once a newer
+  /// one expires no earlier, so deadlines strictly decrease towards the back
+  /// and expired events collect at the back where they are removed.
+  std::vector<std::pair<size_t, DeadlineType>> live_events_;
+};
+
+/// BatchPublisher stores trivially copyable payloads such as int, double or
+/// small PODs contiguously instead of wrapping each of them into a heap
+/// allocated Event<T>. This reduces the per event overhead to sizeof(T) and
+/// allows the Listener to read unread events as std::span<const T>.
+/// Events are stored in fixed size segments that are never reallocated, so
+/// spans returned by Listener::ReadBatch<T>() stay valid for the lifetime of
+/// the BatchPublisher.
+/// Usage:
+///       auto p = event_bus->CreateBatchPublisher<double>(0);
+///       p->Publish(4.18);
+///       for (double v : listener->ReadBatch<double>()) sum += v;
+template <typename T>
+class BatchPublisher : public internal::PublisherBase {
+ public:
+  static_assert(std::is_trivially_copyable_v<T>,
+                "BatchPublisher requires a trivially copyable type");
+
+  friend class EventBus;
+
+  /// Amount of events stored per segment. A single span returned by
+  /// ReadBatch never crosses a segment boundary.
+  static constexpr size_t kSegmentSize =
+      std::max<size_t>(1, 65536 / sizeof(T));
+
+  ~BatchPublisher() = default;
+
+  // BatchPublisher is not copyable due to the use of std::shared_mutex
+  BatchPublisher(const BatchPublisher&) = delete;
+  const BatchPublisher& operator=(const BatchPublisher&) = delete;
+
+  /// BatchPublisher::HasReceivedEvent(size_t index) checks if there are unread
+  /// events for the Listener
+  virtual bool HasReceivedEvent(size_t index) override {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+    return index < writer_index_;
+  }
+
+  /// Copies the value into the channel storage and notifies the Listeners.
+  bool Publish(const T& value) {
+    return Publish(std::span<const T>(&value, 1));
+  }
+
+  /// Copies all values into the channel storage under a single lock and
+  /// notifies the Listeners once.
+  bool Publish(std::span<const T> values) {
+    if (!get_is_registered()) return false;
+    std::unique_lock<std::shared_mutex> lock(mux_);
+
+    while (!values.empty()) {
+      size_t offset = writer_index_ % kSegmentSize;
+      if (offset == 0)
+        segments_.emplace_back(std::allocator<T>().allocate(kSegmentSize));
+
+      size_t count = std::min(values.size(), kSegmentSize - offset);
+      std::uninitialized_copy_n(values.data(), count,
+                                segments_.back().get() + offset);
+
+      values = values.subspan(count);
+      writer_index_ += count;
+    }
+
+    cv_->notify_all();
+    return true;
+  }
+
+  inline const size_t get_writer_index() { return writer_index_; }
+
+ protected:
+  /// See PublisherBase::ReadBatchImpl(). Events below writer_index_ are never
+  /// written again which is why the returned range may be read without holding
+  /// the lock.
+  virtual std::pair<const void*, size_t> ReadBatchImpl(
+      size_t index, size_t max_count, const std::type_info& type) override {
+    if (type != typeid(T)) return {nullptr, 0};
+
+    std::shared_lock<std::shared_mutex> lock(mux_);
+
+    if (index >= writer_index_) return {nullptr, 0};
+
+    size_t offset = index % kSegmentSize;
+    size_t count = std::min({writer_index_ - index, kSegmentSize - offset,
+                             max_count});
+
+    return {segments_[index / kSegmentSize].get() + offset, count};
+  }
+
+ private:
+  BatchPublisher() : PublisherBase() {}
+  /// BatchPublisher()::Create() was made private to ensure that it is only
+  /// created via the EventBus::CreateBatchPublisher() function.
+  static std::shared_ptr<BatchPublisher<T>> Create() {
+    return std::shared_ptr<BatchPublisher<T>>(new BatchPublisher<T>());
+  }
+
+ private:
+  /// Segments are allocated without constructing any T since T is not
+  /// required to be default constructible. Events are copy constructed into
+  /// the segment by Publish() and trivially copyable types need no destructor.
+  struct SegmentDeleter {
+    void operator()(T* segment) const {
+      std::allocator<T>().deallocate(segment, kSegmentSize);
+    }
+  };
+
+  std::vector<std::unique_ptr<T, SegmentDeleter>> segments_;
+  size_t writer_index_ = 0;
+};
+
+/// DeltaPublisher is used for latest-value channels of large state objects in
+/// which only a few fields change per update. Instead of publishing a full copy
+/// of the state each time the publisher submits a Patch against the current
+/// version. Pending patches are compacted into a new snapshot every
+/// compaction_interval_ versions or when a Listener reads the latest state.
+/// A Listener that is behind can catch up by applying only the pending patches
+/// to its own copy via Listener::CatchUp<T>().
+/// NOTE: A Patch may be applied several times and by several Listeners at
+/// once. Patches must therefore not modify any captured state and have to
+/// produce the same result each time they are applied.
+/// Usage:
+///       auto p = event_bus->CreateDeltaPublisher<State>(0);
+///       p->PublishSnapshot(State{});
+///       p->PublishDelta(p->get_version(), [](State& s) { s.value = 418; });
+template <typename T>
+class DeltaPublisher : public internal::PublisherBase {
+ public:
+  using Patch = std::function<void(T&)>;
+
+  friend class EventBus;
+
+  static constexpr size_t kDefaultCompactionInterval = 16;
+
+  ~DeltaPublisher() = default;
+
+  // DeltaPublisher is not copyable due to the use of std::shared_mutex
+  DeltaPublisher(const DeltaPublisher&) = delete;
+  const DeltaPublisher& operator=(const DeltaPublisher&) = delete;
+
+  /// DeltaPublisher::HasReceivedEvent(size_t index) checks if there is a newer
+  /// version than index.
+  virtual bool HasReceivedEvent(size_t index) override {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+    return index < version_;
+  }
+
+  /// Replaces the state with a new snapshot and drops all pending patches.
+  bool PublishSnapshot(T state) {
+    if (!get_is_registered()) return false;
+    std::unique_lock<std::shared_mutex> lock(mux_);
+
+    current_ = state;
+    snapshot_ = std::make_shared<const internal::OwningEvent<T>>(
+        EventType::SNAPSHOT, get_channel_id(), std::move(state));
+    deltas_.clear();
+    snapshot_version_ = ++version_;
+
+    cv_->notify_all();
+    return true;
+  }
+
+  /// Applies patch to the state of base_version. Returns false if patch is
+  /// empty, there is no snapshot yet or base_version is outdated, in which case
+  /// the publisher has to rebase its patch onto get_version(). If patch throws
+  /// the exception is passed on and neither the state nor the version change.
+  bool PublishDelta(size_t base_version, Patch patch) {
+    if (!get_is_registered() || !patch) return false;
+    std::unique_lock<std::shared_mutex> lock(mux_);
+
+    if (!snapshot_ || base_version != version_) return false;
+
+    // The patch is applied to a copy first so that a throwing patch is never
+    // stored and replayed by CatchUp() or Compact().
+    T next = *current_;
+    patch(next);
+    current_ = std::move(next);
+
+    deltas_.push_back(std::move(patch));
+    ++version_;
+    if (deltas_.size() >= compaction_interval_) Compact();
+
+    cv_->notify_all();
+    return true;
+  }
+
+  /// Brings state from version up to the latest version. If the patches since
+  /// version are still pending only those are applied, otherwise state is
+  /// replaced by the latest snapshot first. Returns false if state is already
+  /// up to date or nothing was published yet.
+  bool CatchUp(T& state, size_t& version) {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+
+    if (!snapshot_ || version >= version_) return false;
+
+    if (version < snapshot_version_) {
+      state = *snapshot_->template GetData<T>();
+      version = snapshot_version_;
+    }
+    for (; version < version_; ++version)
+      deltas_[version - snapshot_version_](state);
+
+    return true;
+  }
+
+  inline const size_t get_version() {
+    std::shared_lock<std::shared_mutex> lock(mux_);
+    return version_;
+  }
+  inline void set_compaction_interval(size_t interval) {
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    compaction_interval_ = std::max<size_t>(1, interval);
+  }
+
+ protected:
+  /// See PublisherBase::ReadLatestImpl(). Pending patches are compacted first
+  /// so that the returned snapshot reflects the latest version.
+  virtual const std::shared_ptr<const internal::EventBase> ReadLatestImpl()
+      override {
+    size_t version = 0;
+    return ReadNextLatestImpl(version);
+  }
+
+  /// Sets read_index to the version of the returned snapshot so that
+  /// HasReceivedEvent() compares against versions as well.
+  virtual const std::shared_ptr<const internal::EventBase> ReadNextLatestImpl(
+      size_t& read_index) override {
+    {
+      std::shared_lock<std::shared_mutex> lock(mux_);
+      if (deltas_.empty()) {
+        if (snapshot_) read_index = snapshot_version_;
+        return snapshot_;
+      }
+    }
+
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    if (!deltas_.empty()) Compact();
+    if (snapshot_) read_index = snapshot_version_;
+    return snapshot_;
+  }
+
+  /// See PublisherBase::CatchUpImpl()
+  virtual bool CatchUpImpl(void* state, size_t& version,
+                           const std::type_info& type) override {
+    if (type != typeid(T)) return false;
+    return CatchUp(*static_cast<T*>(state), version);
+  }
+
+ private:
+  DeltaPublisher() : PublisherBase() {}
+  /// DeltaPublisher()::Create() was made private to ensure that it is only
+  /// created via the EventBus::CreateDeltaPublisher() function.
+  static std::shared_ptr<DeltaPublisher<T>> Create() {
+    return std::shared_ptr<DeltaPublisher<T>>(new DeltaPublisher<T>());
+  }
+
+  /// Turns the current state into a new snapshot and drops the pending
+  /// patches. The old snapshot stays valid for Listeners that still hold it.
+  /// Requires mux_ to be locked.
+  void Compact() {
+    snapshot_ = std::make_shared<const internal::OwningEvent<T>>(
+        EventType::SNAPSHOT, get_channel_id(), *current_);
+    deltas_.clear();
+    snapshot_version_ = version_;
+  }
+
+ private:
+  std::shared_ptr<const internal::OwningEvent<T>> snapshot_;
+  /// The state of version_. It is empty until the first snapshot.
+  std::optional<T> current_;
+  /// deltas_[i] turns version snapshot_version_ + i into the next version.
+  std::vector<Patch> deltas_;
+  size_t snapshot_version_ = 0;
+  size_t version_ = 0;
+  size_t compaction_interval_ = kDefaultCompactionInterval;
 };
 
 /// Listener is used to read events from the Publisher. It is designed to be
@@ -300,25 +858,63 @@ class Listener : public std::enable_shared_from_this<Listener> {
     publisher_ = channel_->get_publisher();
   }
 
-  /// Returns the latest event published by the Publisher. If there are no
-  /// events it returns nullptr.
+  /// Returns the latest event published by the Publisher that has not expired.
+  /// If there is no such event it returns nullptr.
   template <typename EvTyp>
   const std::shared_ptr<const Event<EvTyp>> ReadLatest() {
     std::shared_lock<std::shared_mutex> lock(mux_);
 
     if (!ValidatePublisher()) return nullptr;
 
-    auto event = publisher_->ReadLatestImpl();
+    auto event = publisher_->ReadNextLatestImpl(read_index_);
     if (event == nullptr) return nullptr;
 
     auto latest_converted = std::static_pointer_cast<const Event<EvTyp>>(event);
     if (!latest_converted)
       assert(false && "ReadLatest tried retrieving data of wrong format");
 
-    read_index_++;
     return latest_converted;
   }
 
+  /// Returns the unread events of a BatchPublisher<T> channel as a contiguous
+  /// span and marks them as read. At most max_count events are returned and
+  /// the span never crosses a storage segment, so call this repeatedly until it
+  /// returns an empty span to drain the channel.
+  /// NOTE: Only use this on channels created via
+  /// EventBus::CreateBatchPublisher<T>(). Other channels or a different T
+  /// return an empty span.
+  template <typename T>
+  std::span<const T> ReadBatch(size_t max_count = SIZE_MAX) {
+    std::unique_lock<std::shared_mutex> lock(mux_);
+
+    if (!ValidatePublisher()) return {};
+
+    auto [data, count] =
+        publisher_->ReadBatchImpl(read_index_, max_count, typeid(T));
+    if (data == nullptr) return {};
+
+    read_index_ += count;
+    return std::span<const T>(static_cast<const T*>(data), count);
+  }
+
+  /// Brings state up to date with a DeltaPublisher<T> channel. version is the
+  /// version state currently reflects, 0 if it is empty, and is updated to the
+  /// latest version. Returns false if there was nothing new.
+  /// NOTE: Only use this on channels created via
+  /// EventBus::CreateDeltaPublisher<T>(). Other channels or a different T
+  /// return false.
+  template <typename T>
+  bool CatchUp(T& state, size_t& version) {
+    std::unique_lock<std::shared_mutex> lock(mux_);
+
+    if (!ValidatePublisher()) return false;
+
+    if (!publisher_->CatchUpImpl(&state, version, typeid(T))) return false;
+
+    read_index_ = version;
+    return true;
+  }
+
   inline bool HasReceivedEvent() {
     return ValidatePublisher() ? publisher_->HasReceivedEvent(read_index_)
                                : false;
@@ -328,6 +924,12 @@ class Listener : public std::enable_shared_from_this<Listener> {
   inline const bool get_is_subscribed() { return is_subscribed_; }
   inline const ChannelIdType get_channel_id() { return channel_id_; }
   inline const size_t get_read_index() { return read_index_; }
+  /// Returns the advisory priority of the subscribed channel. See
+  /// PublisherBase::get_priority().
+  inline const EventPriority get_priority() {
+    return ValidatePublisher() ? publisher_->get_priority()
+                               : EventPriority::NORMAL;
+  }
   inline const std::shared_ptr<EventBus> get_event_bus() { return event_bus_; }
 
  protected:
@@ -411,30 +1013,151 @@ class EventBus : public std::enable_shared_from_this<EventBus> {
   }
 
   /// Returns a shared_ptr to the Publisher object that publishes to the
-  /// specified channel
+  /// specified channel. priority is stored as advisory channel priority, see
+  /// PublisherBase::get_priority(). Returns nullptr if the channel already has
+  /// a publisher of a different kind or type.
   template <typename EvTyp>
   std::shared_ptr<Publisher<EvTyp>> CreatePublisher(
-      const ChannelIdType& channel) {
+      const ChannelIdType& channel,
+      EventPriority priority = EventPriority::NORMAL) {
     auto channel_ptr = GetChannel(channel);
 
     std::unique_lock<std::shared_mutex> lock(mux_);
     // If the channel already has a publisher we avoid creating a new one. And
-    // instead share the access to it.
-    if (channel_ptr->get_publisher() != nullptr)
-      return std::static_pointer_cast<Publisher<EvTyp>>(
+    // instead share the access to it with the higher of both priorities. A
+    // publisher of a different kind or type is not shared.
+    if (channel_ptr->get_publisher() != nullptr) {
+      auto shared = std::dynamic_pointer_cast<Publisher<EvTyp>>(
           channel_ptr->get_publisher());
+      if (shared) shared->RaisePriority(priority);
+      return shared;
+    }
 
     auto publisher = Publisher<EvTyp>::Create();
-    publisher->CreatePublisher(channel_ptr);
+    publisher->CreatePublisher(channel_ptr, priority);
+    channel_ptr->CreatePublisher(publisher);
+
+    return publisher;
+  }
+
+  /// Returns a shared_ptr to a BatchPublisher object that publishes trivially
+  /// copyable values to the specified channel. See BatchPublisher. Returns
+  /// nullptr if the channel already has a publisher of a different kind or
+  /// type.
+  template <typename T>
+  std::shared_ptr<BatchPublisher<T>> CreateBatchPublisher(
+      const ChannelIdType& channel,
+      EventPriority priority = EventPriority::NORMAL) {
+    auto channel_ptr = GetChannel(channel);
+
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    // If the channel already has a publisher we avoid creating a new one. And
+    // instead share the access to it with the higher of both priorities. A
+    // publisher of a different kind or type is not shared.
+    if (channel_ptr->get_publisher() != nullptr) {
+      auto shared = std::dynamic_pointer_cast<BatchPublisher<T>>(
+          channel_ptr->get_publisher());
+      if (shared) shared->RaisePriority(priority);
+      return shared;
+    }
+
+    auto publisher = BatchPublisher<T>::Create();
+    publisher->CreatePublisher(channel_ptr, priority);
+    channel_ptr->CreatePublisher(publisher);
+
+    return publisher;
+  }
+
+  /// Returns a shared_ptr to a DeltaPublisher object that publishes patches of
+  /// a state object to the specified channel. See DeltaPublisher. Returns
+  /// nullptr if the channel already has a publisher of a different kind or
+  /// type.
+  template <typename T>
+  std::shared_ptr<DeltaPublisher<T>> CreateDeltaPublisher(
+      const ChannelIdType& channel,
+      EventPriority priority = EventPriority::NORMAL) {
+    auto channel_ptr = GetChannel(channel);
+
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    // If the channel already has a publisher we avoid creating a new one. And
+    // instead share the access to it with the higher of both priorities. A
+    // publisher of a different kind or type is not shared.
+    if (channel_ptr->get_publisher() != nullptr) {
+      auto shared = std::dynamic_pointer_cast<DeltaPublisher<T>>(
+          channel_ptr->get_publisher());
+      if (shared) shared->RaisePriority(priority);
+      return shared;
+    }
+
+    auto publisher = DeltaPublisher<T>::Create();
+    publisher->CreatePublisher(channel_ptr, priority);
     channel_ptr->CreatePublisher(publisher);
 
     return publisher;
   }
 
+  /// Registers handler to answer requests of type Req sent to the specified
+  /// channel. The handler is called on a worker thread owned by the channel.
+  /// Returns false if the channel is already served.
+  template <typename Req, typename Resp>
+  bool Serve(const ChannelIdType& channel,
+             std::function<Resp(const Event<Req>&)> handler) {
+    auto channel_ptr = GetChannel(channel);
+
+    std::unique_lock<std::shared_mutex> lock(mux_);
+    return channel_ptr->CreateService(
+        std::make_shared<internal::Service<Req, Resp>>(channel,
+                                                       std::move(handler)));
+  }
+
+  /// Sends request to the Service of the specified channel and returns a
+  /// future to the reply. The reply carries the same correlation ID as the
+  /// request. The future resolves to nullptr if the channel is not served with
+  /// the types Req and Resp or if the request was still queued after timeout.
+  /// Requests of higher priority are handled first.
+  /// NOTE: timeout does not interrupt a handler that is already running, so
+  /// the future may resolve later than timeout. Callers that need a bounded
+  /// wait have to use wait_for(timeout) themselves. Usage:
+  ///       auto reply = eb->Request<int, int>(0, 418, 100ms);
+  ///       if (reply.wait_for(100ms) == std::future_status::ready) ...
+  template <typename Req, typename Resp>
+  std::future<std::shared_ptr<const Event<Resp>>> Request(
+      const ChannelIdType& channel, Req request,
+      std::chrono::milliseconds timeout,
+      EventPriority priority = EventPriority::NORMAL) {
+    // A channel served with different types is treated as not served.
+    auto service = std::dynamic_pointer_cast<internal::Service<Req, Resp>>(
+        GetChannel(channel)->get_service());
+
+    if (!service) {
+      std::promise<std::shared_ptr<const Event<Resp>>> no_reply;
+      no_reply.set_value(nullptr);
+      return no_reply.get_future();
+    }
+
+    return service->Submit(next_correlation_id_++, std::move(request),
+                           DeadlineAfter(timeout), priority);
+  }
+
   // Getters
   inline const int GetChannelCount() { return channels_.size(); }
 
  protected:
+  /// Returns the point in time timeout from now. Timeouts that reach past
+  /// DeadlineType::max() are capped so they never expire instead of
+  /// overflowing into the past. Negative timeouts are treated as 0.
+  static DeadlineType DeadlineAfter(std::chrono::milliseconds timeout) {
+    auto now = std::chrono::steady_clock::now();
+    // Compare in milliseconds since converting timeout to the clock's duration
+    // could overflow as well.
+    if (timeout >= std::chrono::duration_cast<std::chrono::milliseconds>(
+                       DeadlineType::max() - now))
+      return DeadlineType::max();
+    if (timeout < std::chrono::milliseconds::zero()) return now;
+
+    return now + timeout;
+  }
+
   /// Returns the Channel with the specified ID. If no Channel with that ID
   /// exists it instantiates a new one.
   std::shared_ptr<internal::Channel> EventBus::GetChannel(
@@ -461,6 +1184,9 @@ class EventBus : public std::enable_shared_from_this<EventBus> {
   // Channels are stored together with their ID for fast lookups.
   std::unordered_map<ChannelIdType, std::shared_ptr<internal::Channel>>
       channels_;
+
+  // 0 is reserved for events that are not part of a request.
+  std::atomic<CorrelationIdType> next_correlation_id_ = 1;
 };
 
 }  // namespace habitify
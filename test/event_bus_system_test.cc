@@ -17,9 +17,14 @@
 // Contact via <https://github.com/SPauly/habitify-event-bus>
 #include <gtest/gtest.h>
 
+#include <chrono>
+#include <future>
 #include <memory>
+#include <span>
+#include <stdexcept>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "src/habitify_event.h"
 #include "src/habitify_event_bus.h"
@@ -111,6 +116,442 @@ TEST_F(EventBusTest, ThreadSafety) {
   listener_thread.join();
 }
 
+TEST_F(EventBusTest, BatchPublishAndReadBatch) {
+  auto publisher = event_bus_->CreateBatchPublisher<double>(2);
+  auto listener = event_bus_->CreateSubscriber(2);
+  ASSERT_TRUE(publisher != nullptr);
+  ASSERT_TRUE(listener != nullptr);
+
+  EXPECT_TRUE(publisher->Publish(1.0));
+  std::vector<double> values{2.0, 3.0, 4.0};
+  EXPECT_TRUE(publisher->Publish(std::span<const double>(values)));
+  EXPECT_EQ(publisher->get_writer_index(), 4);
+  EXPECT_TRUE(listener->HasReceivedEvent());
+
+  // The first read is limited by max_count, the second one drains the rest.
+  auto first = listener->ReadBatch<double>(2);
+  ASSERT_EQ(first.size(), 2);
+  EXPECT_EQ(first[0], 1.0);
+  EXPECT_EQ(first[1], 2.0);
+
+  auto second = listener->ReadBatch<double>();
+  ASSERT_EQ(second.size(), 2);
+  EXPECT_EQ(second[0] + second[1], 7.0);
+
+  EXPECT_FALSE(listener->HasReceivedEvent());
+  EXPECT_TRUE(listener->ReadBatch<double>().empty());
+  EXPECT_EQ(listener->get_read_index(), 4);
+
+  // Reading with the wrong type or from a regular channel returns nothing
+  EXPECT_TRUE(publisher->Publish(5.0));
+  EXPECT_TRUE(listener->ReadBatch<float>().empty());
+  EXPECT_TRUE(listener_int_->ReadBatch<int>().empty());
+  EXPECT_EQ(listener->ReadBatch<double>().size(), 1);
+}
+
+struct NoDefaultSample {
+  NoDefaultSample(long long ts, double value) : ts(ts), value(value) {}
+  long long ts;
+  double value;
+};
+
+TEST_F(EventBusTest, BatchWithoutDefaultConstructor) {
+  auto publisher = event_bus_->CreateBatchPublisher<NoDefaultSample>(12);
+  auto listener = event_bus_->CreateSubscriber(12);
+
+  ASSERT_TRUE(publisher->Publish(NoDefaultSample(1, 4.18)));
+  auto batch = listener->ReadBatch<NoDefaultSample>();
+  ASSERT_EQ(batch.size(), 1);
+  EXPECT_EQ(batch[0].ts, 1);
+  EXPECT_EQ(batch[0].value, 4.18);
+}
+
+TEST_F(EventBusTest, MismatchedPublisherKinds) {
+  // Channel 0 already has a Publisher<int>
+  EXPECT_EQ(event_bus_->CreateBatchPublisher<int>(0), nullptr);
+
+  auto batch_publisher = event_bus_->CreateBatchPublisher<int>(15);
+  ASSERT_TRUE(batch_publisher != nullptr);
+  EXPECT_EQ(event_bus_->CreateBatchPublisher<int>(15), batch_publisher);
+  EXPECT_EQ(event_bus_->CreateBatchPublisher<float>(15), nullptr);
+  EXPECT_EQ(event_bus_->CreatePublisher<int>(15), nullptr);
+  EXPECT_EQ(event_bus_->CreatePublisher<double>(0), nullptr);
+}
+
+TEST_F(EventBusTest, BatchReadAcrossSegments) {
+  auto publisher = event_bus_->CreateBatchPublisher<int>(3);
+  auto listener = event_bus_->CreateSubscriber(3);
+  constexpr size_t kAmount = BatchPublisher<int>::kSegmentSize + 10;
+
+  std::vector<int> values(kAmount);
+  for (size_t i = 0; i < kAmount; i++) values[i] = static_cast<int>(i);
+  ASSERT_TRUE(publisher->Publish(std::span<const int>(values)));
+
+  size_t read = 0;
+  for (auto batch = listener->ReadBatch<int>(); !batch.empty();
+       batch = listener->ReadBatch<int>()) {
+    for (int value : batch) EXPECT_EQ(value, static_cast<int>(read++));
+  }
+  EXPECT_EQ(read, kAmount);
+}
+
+TEST_F(EventBusTest, BatchThreadSafety) {
+  auto publisher = event_bus_->CreateBatchPublisher<int>(4);
+  auto listener = event_bus_->CreateSubscriber(4);
+
+  std::thread listener_thread([&]() {
+    long long sum = 0;
+    while (listener->get_read_index() < 1000) {
+      for (int value : listener->ReadBatch<int>()) sum += value;
+    }
+    EXPECT_EQ(sum, 1000LL * test_value_);
+  });
+
+  std::thread publisher_thread([&]() {
+    for (int i = 0; i < 1000; i++) EXPECT_TRUE(publisher->Publish(test_value_));
+  });
+
+  publisher_thread.join();
+  listener_thread.join();
+}
+
+TEST_F(EventBusTest, RequestAndReply) {
+  ASSERT_TRUE((event_bus_->Serve<int, std::string>(
+      5, [](const Event<int>& request) {
+        return std::to_string(*request.GetData<int>());
+      })));
+  // A channel can only be served once
+  EXPECT_FALSE((event_bus_->Serve<int, std::string>(
+      5, [](const Event<int>&) { return std::string(); })));
+
+  auto first = event_bus_->Request<int, std::string>(
+      5, test_value_, std::chrono::milliseconds(1000));
+  auto second = event_bus_->Request<int, std::string>(
+      5, 7, std::chrono::milliseconds(1000));
+
+  auto first_reply = first.get();
+  auto second_reply = second.get();
+  ASSERT_TRUE(first_reply != nullptr);
+  ASSERT_TRUE(second_reply != nullptr);
+  EXPECT_EQ(*first_reply->GetData<std::string>(), "418");
+  EXPECT_EQ(*second_reply->GetData<std::string>(), "7");
+  EXPECT_EQ(first_reply->get_event_type(), EventType::REPLY);
+  EXPECT_NE(first_reply->get_correlation_id(), 0);
+  EXPECT_NE(first_reply->get_correlation_id(),
+            second_reply->get_correlation_id());
+}
+
+TEST_F(EventBusTest, RequestWithMaximumTimeout) {
+  ASSERT_TRUE((event_bus_->Serve<int, int>(
+      16, [](const Event<int>& request) { return *request.GetData<int>(); })));
+
+  // The deadline is capped instead of overflowing into the past
+  auto reply = event_bus_->Request<int, int>(
+      16, test_value_, std::chrono::milliseconds::max());
+  auto reply_event = reply.get();
+  ASSERT_TRUE(reply_event != nullptr);
+  EXPECT_EQ(*reply_event->GetData<int>(), test_value_);
+}
+
+TEST_F(EventBusTest, RequestWithoutServiceAndTimeout) {
+  // Nobody serves channel 6 so the request resolves to nullptr immediately
+  auto unserved = event_bus_->Request<int, int>(6, test_value_,
+                                                std::chrono::milliseconds(10));
+  EXPECT_EQ(unserved.get(), nullptr);
+
+  // Requests with types that do not match the Service resolve to nullptr
+  ASSERT_TRUE((event_bus_->Serve<int, std::string>(
+      13, [](const Event<int>&) { return std::string(); })));
+  auto mismatched = event_bus_->Request<int, int>(
+      13, test_value_, std::chrono::milliseconds(10));
+  EXPECT_EQ(mismatched.get(), nullptr);
+
+  std::promise<void> started;
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  ASSERT_TRUE((event_bus_->Serve<int, int>(
+      7, [&started, released](const Event<int>& request) {
+        if (*request.GetData<int>() == 1) started.set_value();
+        released.wait();
+        return *request.GetData<int>();
+      })));
+
+  // The first request blocks the worker until the second one has expired.
+  // Wait until the worker handles it, otherwise the earlier deadline of the
+  // second request would be served first.
+  auto blocking =
+      event_bus_->Request<int, int>(7, 1, std::chrono::milliseconds(1000));
+  started.get_future().wait();
+  auto expiring =
+      event_bus_->Request<int, int>(7, 2, std::chrono::milliseconds(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  release.set_value();
+
+  ASSERT_TRUE(blocking.get() != nullptr);
+  EXPECT_EQ(expiring.get(), nullptr);
+}
+
+TEST_F(EventBusTest, ChannelPriorityAndExpiredEvents) {
+  auto publisher = event_bus_->CreatePublisher<int>(8, EventPriority::HIGH);
+  auto listener = event_bus_->CreateSubscriber(8);
+  EXPECT_EQ(publisher->get_priority(), EventPriority::HIGH);
+  EXPECT_EQ(listener->get_priority(), EventPriority::HIGH);
+  EXPECT_EQ(listener_int_->get_priority(), EventPriority::NORMAL);
+
+  // Sharing the publisher merges the requested priority
+  EXPECT_EQ(event_bus_->CreatePublisher<int>(8), publisher);
+  EXPECT_EQ(publisher->get_priority(), EventPriority::HIGH);
+  event_bus_->CreatePublisher<int>(0, EventPriority::HIGH);
+  EXPECT_EQ(listener_int_->get_priority(), EventPriority::HIGH);
+
+  auto expired = std::make_unique<Event<int>>(event_int_);
+  expired->set_deadline(std::chrono::steady_clock::now() -
+                        std::chrono::milliseconds(1));
+  ASSERT_TRUE(publisher->Publish(std::unique_ptr<const Event<int>>(
+      std::move(expired))));
+  EXPECT_FALSE(listener->HasReceivedEvent());
+  EXPECT_EQ(listener->ReadLatest<int>(), nullptr);
+
+  int valid_value = 7;
+  auto valid = std::make_unique<Event<int>>(EventType::TEST, 8, &valid_value);
+  valid->set_deadline(std::chrono::steady_clock::now() +
+                      std::chrono::seconds(10));
+  ASSERT_TRUE(
+      publisher->Publish(std::unique_ptr<const Event<int>>(std::move(valid))));
+  EXPECT_TRUE(listener->HasReceivedEvent());
+
+  // An expired newer event falls back to the newest event that has not expired
+  expired = std::make_unique<Event<int>>(event_int_);
+  expired->set_deadline(std::chrono::steady_clock::now() -
+                        std::chrono::milliseconds(1));
+  ASSERT_TRUE(publisher->Publish(std::unique_ptr<const Event<int>>(
+      std::move(expired))));
+  auto latest = listener->ReadLatest<int>();
+  ASSERT_TRUE(latest != nullptr);
+  EXPECT_EQ(*latest->GetData<int>(), valid_value);
+}
+
+TEST_F(EventBusTest, ExpiringEventFlood) {
+  auto publisher = event_bus_->CreatePublisher<int>(17);
+  auto listener = event_bus_->CreateSubscriber(17);
+
+  // An event without a deadline followed by one that expires shortly after
+  ASSERT_TRUE(
+      publisher->Publish(std::make_unique<const Event<int>>(event_int_)));
+  int short_value = 1;
+  auto short_lived =
+      std::make_unique<Event<int>>(EventType::TEST, 17, &short_value);
+  short_lived->set_deadline(std::chrono::steady_clock::now() +
+                            std::chrono::milliseconds(5));
+  ASSERT_TRUE(publisher->Publish(
+      std::unique_ptr<const Event<int>>(std::move(short_lived))));
+  EXPECT_EQ(*listener->ReadLatest<int>()->GetData<int>(), short_value);
+
+  for (int i = 0; i < 10000; i++) {
+    auto expired = std::make_unique<Event<int>>(event_int_);
+    expired->set_deadline(std::chrono::steady_clock::now() -
+                          std::chrono::milliseconds(1));
+    ASSERT_TRUE(publisher->Publish(
+        std::unique_ptr<const Event<int>>(std::move(expired))));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  // Once the short lived event expired the event without a deadline is the
+  // latest one that is delivered
+  EXPECT_FALSE(listener->HasReceivedEvent());
+  auto latest = listener->ReadLatest<int>();
+  ASSERT_TRUE(latest != nullptr);
+  EXPECT_EQ(*latest->GetData<int>(), test_value_);
+}
+
+TEST_F(EventBusTest, RequestPriority) {
+  std::promise<void> started;
+  std::promise<void> release;
+  auto released = release.get_future().share();
+  std::vector<int> handled;
+  ASSERT_TRUE((event_bus_->Serve<int, int>(
+      9, [&started, released, &handled](const Event<int>& request) {
+        if (*request.GetData<int>() == 0) started.set_value();
+        released.wait();
+        handled.push_back(*request.GetData<int>());
+        return *request.GetData<int>();
+      })));
+
+  // The first request blocks the worker until all others are queued.
+  auto blocking =
+      event_bus_->Request<int, int>(9, 0, std::chrono::milliseconds(1000));
+  started.get_future().wait();
+  auto low = event_bus_->Request<int, int>(9, 1, std::chrono::seconds(10),
+                                           EventPriority::LOW);
+  auto late = event_bus_->Request<int, int>(9, 2, std::chrono::seconds(10));
+  auto early = event_bus_->Request<int, int>(9, 3, std::chrono::seconds(1));
+  auto high = event_bus_->Request<int, int>(9, 4, std::chrono::seconds(10),
+                                            EventPriority::HIGH);
+  release.set_value();
+
+  ASSERT_TRUE(low.get() != nullptr);
+  ASSERT_TRUE(blocking.get() != nullptr);
+  ASSERT_TRUE(late.get() != nullptr);
+  ASSERT_TRUE(early.get() != nullptr);
+  ASSERT_TRUE(high.get() != nullptr);
+  EXPECT_EQ(handled, std::vector<int>({0, 4, 3, 2, 1}));
+}
+
+struct LargeState {
+  std::vector<int> values = std::vector<int>(1024, 0);
+  std::string name;
+};
+
+TEST_F(EventBusTest, DeltaPublishAndCatchUp) {
+  auto publisher = event_bus_->CreateDeltaPublisher<LargeState>(10);
+  auto listener = event_bus_->CreateSubscriber(10);
+  publisher->set_compaction_interval(4);
+
+  // Patches require a snapshot to apply to
+  EXPECT_FALSE(publisher->PublishDelta(0, [](LargeState&) {}));
+  ASSERT_TRUE(publisher->PublishSnapshot(LargeState()));
+  EXPECT_EQ(publisher->get_version(), 1);
+
+  LargeState state;
+  size_t version = 0;
+  ASSERT_TRUE(listener->CatchUp(state, version));
+  EXPECT_EQ(version, 1);
+  EXPECT_FALSE(listener->HasReceivedEvent());
+  EXPECT_FALSE(listener->CatchUp(state, version));
+
+  ASSERT_TRUE(publisher->PublishDelta(
+      1, [](LargeState& s) { s.values[0] = 418; }));
+  // Patches against an outdated version are rejected
+  EXPECT_FALSE(
+      publisher->PublishDelta(1, [](LargeState& s) { s.name = "stale"; }));
+  ASSERT_TRUE(publisher->PublishDelta(
+      2, [](LargeState& s) { s.name = "delta"; }));
+  EXPECT_TRUE(listener->HasReceivedEvent());
+
+  // The listener is behind by two versions and only applies the patches
+  ASSERT_TRUE(listener->CatchUp(state, version));
+  EXPECT_EQ(version, 3);
+  EXPECT_EQ(state.values[0], 418);
+  EXPECT_EQ(state.name, "delta");
+
+  // Compaction drops the patches so a stale listener restarts from the
+  // snapshot
+  for (int i = 0; i < 4; i++) {
+    ASSERT_TRUE(publisher->PublishDelta(
+        publisher->get_version(), [i](LargeState& s) { s.values[1] = i; }));
+  }
+  LargeState stale_state;
+  size_t stale_version = 2;
+  ASSERT_TRUE(listener->CatchUp(stale_state, stale_version));
+  EXPECT_EQ(stale_version, 7);
+  EXPECT_EQ(stale_state.values[0], 418);
+  EXPECT_EQ(stale_state.values[1], 3);
+  EXPECT_EQ(stale_state.name, "delta");
+
+  // ReadLatest returns the compacted snapshot
+  ASSERT_TRUE(publisher->PublishDelta(
+      7, [](LargeState& s) { s.name = "latest"; }));
+  auto latest = listener->ReadLatest<LargeState>();
+  ASSERT_TRUE(latest != nullptr);
+  EXPECT_EQ(latest->GetData<LargeState>()->name, "latest");
+  EXPECT_EQ(latest->GetData<LargeState>()->values[1], 3);
+
+  // Catching up on other channels or with a different type is rejected
+  int other_state = 0;
+  size_t other_version = 0;
+  EXPECT_FALSE(listener->CatchUp(other_state, other_version));
+  EXPECT_FALSE(listener_int_->CatchUp(state, version));
+}
+
+TEST_F(EventBusTest, DeltaRejectsInvalidPatches) {
+  auto publisher = event_bus_->CreateDeltaPublisher<LargeState>(18);
+  auto listener = event_bus_->CreateSubscriber(18);
+  publisher->set_compaction_interval(1);
+  ASSERT_TRUE(publisher->PublishSnapshot(LargeState()));
+
+  // Empty patches are rejected
+  EXPECT_FALSE(publisher->PublishDelta(1, nullptr));
+  EXPECT_EQ(publisher->get_version(), 1);
+
+  // A throwing patch is neither stored nor changes the state or version
+  EXPECT_THROW(publisher->PublishDelta(1,
+                                       [](LargeState& s) {
+                                         s.values[0] = -1;
+                                         throw std::runtime_error("bad");
+                                       }),
+               std::runtime_error);
+  EXPECT_EQ(publisher->get_version(), 1);
+  EXPECT_EQ(
+      listener->ReadLatest<LargeState>()->GetData<LargeState>()->values[0], 0);
+
+  // The channel keeps working including compaction and catching up
+  ASSERT_TRUE(publisher->PublishDelta(
+      1, [](LargeState& s) { s.name = "valid"; }));
+  auto latest = listener->ReadLatest<LargeState>();
+  ASSERT_TRUE(latest != nullptr);
+  EXPECT_EQ(latest->GetData<LargeState>()->name, "valid");
+  EXPECT_EQ(latest->GetData<LargeState>()->values[0], 0);
+
+  LargeState state;
+  size_t version = 0;
+  ASSERT_TRUE(listener->CatchUp(state, version));
+  EXPECT_EQ(version, 2);
+  EXPECT_EQ(state.name, "valid");
+  EXPECT_EQ(state.values[0], 0);
+
+  // Delta channels are not shared with other publisher kinds
+  EXPECT_EQ(event_bus_->CreateDeltaPublisher<LargeState>(18), publisher);
+  EXPECT_EQ(event_bus_->CreateDeltaPublisher<int>(18), nullptr);
+  EXPECT_EQ(event_bus_->CreateDeltaPublisher<int>(0), nullptr);
+}
+
+TEST_F(EventBusTest, DeltaReadLatestTracksVersion) {
+  auto publisher = event_bus_->CreateDeltaPublisher<LargeState>(14);
+  auto listener = event_bus_->CreateSubscriber(14);
+  ASSERT_TRUE(publisher->PublishSnapshot(LargeState()));
+  for (int i = 0; i < 5; i++) {
+    ASSERT_TRUE(publisher->PublishDelta(
+        publisher->get_version(), [i](LargeState& s) { s.values[0] = i; }));
+  }
+
+  ASSERT_TRUE(listener->HasReceivedEvent());
+  auto latest = listener->ReadLatest<LargeState>();
+  ASSERT_TRUE(latest != nullptr);
+  EXPECT_EQ(latest->GetData<LargeState>()->values[0], 4);
+  EXPECT_EQ(listener->get_read_index(), publisher->get_version());
+  EXPECT_FALSE(listener->HasReceivedEvent());
+
+  // Reading again without a new version does not report new events
+  listener->ReadLatest<LargeState>();
+  EXPECT_FALSE(listener->HasReceivedEvent());
+}
+
+TEST_F(EventBusTest, DeltaThreadSafety) {
+  auto publisher = event_bus_->CreateDeltaPublisher<LargeState>(11);
+  auto listener = event_bus_->CreateSubscriber(11);
+  ASSERT_TRUE(publisher->PublishSnapshot(LargeState()));
+
+  std::thread listener_thread([&]() {
+    LargeState state;
+    size_t version = 0;
+    while (version < 101) {
+      if (listener->CatchUp(state, version)) {
+        EXPECT_EQ(state.values[0], static_cast<int>(version) - 1);
+      }
+    }
+  });
+
+  std::thread publisher_thread([&]() {
+    for (int i = 1; i <= 100; i++) {
+      EXPECT_TRUE(publisher->PublishDelta(
+          publisher->get_version(), [i](LargeState& s) { s.values[0] = i; }));
+    }
+  });
+
+  publisher_thread.join();
+  listener_thread.join();
+}
+
 }  // namespace
 
 }  // namespace habitify_testing